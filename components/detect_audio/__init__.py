@@ -12,10 +12,21 @@
 # You should have received a copy of the GNU General Public License
 # along with this program. If not, see <http://www.gnu.org/licenses/>.
 
+import math
+
 import esphome.config_validation as cv
 import esphome.codegen as cg
+import esphome.final_validate as fv
+from esphome import automation
 from esphome.components.i2s_audio import microphone
-from esphome.const import CONF_ID
+from esphome.const import (
+    CONF_ID,
+    CONF_LEVEL,
+    CONF_NAME,
+    CONF_SAMPLE_RATE,
+    CONF_UPDATE_INTERVAL,
+)
+from esphome.core import CORE
 
 CODEOWNERS = ["@hadatko"]
 DEPENDENCIES = ["microphone"]
@@ -26,6 +37,61 @@ CONF_I2S_ID = "i2s_id"
 
 CONF_DETECT_AUDIO_ID = "detect_audio_id"
 CONF_SOUND_SOURCES = "sound_sources"
+MAX_SOUND_SOURCES = 8  # DetectAudio::m_max_sound_sources
+MAX_SOUND_SOURCE_NAME_LEN = 31
+CONF_AVERAGING = "averaging"
+CONF_AVERAGING_FACTOR = "averaging_factor"
+CONF_WELCH_SEGMENTS = "welch_segments"
+
+CONF_BANDS = "bands"
+CONF_RESOLUTION = "resolution"
+CONF_WEIGHTING = "weighting"
+CONF_MIN_FREQUENCY = "min_frequency"
+CONF_MAX_FREQUENCY = "max_frequency"
+DEFAULT_SAMPLE_RATE = 16000  # i2s_audio microphone default
+BUFFER_SIZE = 1024  # DetectAudio::m_buffer_size
+MAX_BANDS = 48  # DetectAudio::m_max_bands
+
+BAND_RESOLUTIONS = {
+    "FULL": 1,
+    "THIRD": 3,
+    "SIXTH": 6,
+}
+
+Weighting = DetectAudioComponent.enum("Weighting")
+WEIGHTINGS = {
+    "A": Weighting.WEIGHTING_A,
+    "C": Weighting.WEIGHTING_C,
+    "Z": Weighting.WEIGHTING_Z,
+}
+
+
+def _validate_bands(config):
+    if config[CONF_MIN_FREQUENCY] >= config[CONF_MAX_FREQUENCY]:
+        raise cv.Invalid(f"{CONF_MIN_FREQUENCY} must be lower than {CONF_MAX_FREQUENCY}")
+    return config
+
+
+BANDS_SCHEMA = cv.All(
+    cv.Schema({
+        cv.Optional(CONF_RESOLUTION, default="THIRD"): cv.enum(BAND_RESOLUTIONS, upper=True),
+        cv.Optional(CONF_WEIGHTING, default="A"): cv.enum(WEIGHTINGS, upper=True),
+        cv.Optional(CONF_MIN_FREQUENCY, default="50Hz"): cv.All(cv.frequency, cv.Range(min=1.0)),
+        cv.Optional(CONF_MAX_FREQUENCY, default="10kHz"): cv.All(cv.frequency, cv.Range(min=1.0)),
+        cv.Optional(CONF_UPDATE_INTERVAL, default="10s"): cv.positive_time_period_milliseconds,
+    }),
+    _validate_bands,
+)
+
+SetSoundSourceAction = detect_audio_ns.class_("SetSoundSourceAction", automation.Action)
+RemoveSoundSourceAction = detect_audio_ns.class_("RemoveSoundSourceAction", automation.Action)
+
+AveragingMode = DetectAudioComponent.enum("AveragingMode")
+AVERAGING_MODES = {
+    "NONE": AveragingMode.AVERAGING_NONE,
+    "EXPONENTIAL": AveragingMode.AVERAGING_EXPONENTIAL,
+    "WELCH": AveragingMode.AVERAGING_WELCH,
+}
 
 SOUND_SOURCES_SCHEMA = cv.Schema({
 
@@ -34,17 +100,124 @@ SOUND_SOURCES_SCHEMA = cv.Schema({
 CONFIG_SCHEMA = cv.Schema({
     cv.GenerateID(): cv.declare_id(DetectAudioComponent),
     cv.GenerateID(CONF_I2S_ID): cv.use_id(microphone.I2SAudioMicrophone),
-    cv.Optional(CONF_SOUND_SOURCES): cv.ensure_list(cv.All({cv.Required("name"): cv.string, cv.Required("level"): cv.int_, })),
+    cv.Optional(CONF_SOUND_SOURCES): cv.All(
+        cv.ensure_list({
+            cv.Required(CONF_NAME): cv.All(cv.string, cv.Length(min=1, max=MAX_SOUND_SOURCE_NAME_LEN)),
+            cv.Required(CONF_LEVEL): cv.uint16_t,
+        }),
+        cv.Length(max=MAX_SOUND_SOURCES),
+    ),
+    cv.Optional(CONF_AVERAGING, default="NONE"): cv.enum(AVERAGING_MODES, upper=True),
+    cv.Optional(CONF_AVERAGING_FACTOR, default=0.25): cv.float_range(min=0.0, max=1.0, min_included=False),
+    cv.Optional(CONF_WELCH_SEGMENTS, default=8): cv.int_range(min=1, max=255),
+    cv.Optional(CONF_SAMPLE_RATE): cv.int_range(min=1),
+    cv.Optional(CONF_BANDS): BANDS_SCHEMA,
 })
 
 
+def _sample_rate(config, full_config):
+    # explicit value wins, otherwise take it from the referenced microphone
+    if CONF_SAMPLE_RATE in config:
+        return config[CONF_SAMPLE_RATE]
+    for mic in full_config.get("microphone", []):
+        if mic[CONF_ID] == config[CONF_I2S_ID]:
+            return mic.get(CONF_SAMPLE_RATE, DEFAULT_SAMPLE_RATE)
+    return DEFAULT_SAMPLE_RATE
+
+
+def _band_count(bands, sample_rate):
+    # mirrors DetectAudio::setupBands()
+    fraction = BAND_RESOLUTIONS[bands[CONF_RESOLUTION]]
+    df = sample_rate / BUFFER_SIZE
+    max_frequency = min(bands[CONF_MAX_FREQUENCY], sample_rate / 2)
+    if bands[CONF_MIN_FREQUENCY] >= max_frequency:
+        return 0
+    k_min = math.ceil(fraction * math.log2(bands[CONF_MIN_FREQUENCY] / 1000))
+    k_max = math.floor(fraction * math.log2(max_frequency / 1000))
+    count = 0
+    for k in range(k_min, k_max + 1):
+        center = 1000 * 2 ** (k / fraction)
+        lo = max(center * 2 ** (-0.5 / fraction) / df + 0.5, 1)
+        hi = center * 2 ** (0.5 / fraction) / df + 0.5
+        if hi > BUFFER_SIZE / 2 + 1:
+            break
+        if hi > lo:
+            count += 1
+    return count
+
+
+def _final_validate(config):
+    if CONF_BANDS not in config:
+        return config
+    sample_rate = _sample_rate(config, fv.full_config.get())
+    count = _band_count(config[CONF_BANDS], sample_rate)
+    if count == 0:
+        raise cv.Invalid(f"No band fits into {CONF_MIN_FREQUENCY}..{CONF_MAX_FREQUENCY} at {sample_rate} Hz sample rate", path=[CONF_BANDS])
+    if count > MAX_BANDS:
+        raise cv.Invalid(f"Bands configuration gives {count} bands, at most {MAX_BANDS} are supported. "
+                         f"Raise {CONF_MIN_FREQUENCY}, lower {CONF_MAX_FREQUENCY} or use coarser {CONF_RESOLUTION}", path=[CONF_BANDS])
+    return config
+
+
+FINAL_VALIDATE_SCHEMA = _final_validate
+
+
 async def to_code(config):
     var = cg.new_Pvariable(config[CONF_ID])
     i2s_component = await cg.get_variable(config[CONF_I2S_ID])
     cg.add(var.set_i2s(i2s_component))
-    sound_sources = config[CONF_SOUND_SOURCES]
+    sound_sources = config.get(CONF_SOUND_SOURCES, [])
     for soundSource in sound_sources:
-        cg.add(var.addSoundSource(soundSource["name"], soundSource["level"]))
+        cg.add(var.addSoundSource(soundSource[CONF_NAME], soundSource[CONF_LEVEL]))
+    cg.add(var.set_averaging_mode(config[CONF_AVERAGING]))
+    cg.add(var.set_averaging_factor(config[CONF_AVERAGING_FACTOR]))
+    cg.add(var.set_welch_segments(config[CONF_WELCH_SEGMENTS]))
+    # set_bands() maps bands to bins, sample rate has to be set first
+    cg.add(var.set_sample_rate(_sample_rate(config, CORE.config)))
+    if CONF_BANDS in config:
+        bands = config[CONF_BANDS]
+        cg.add(var.set_bands(
+            bands[CONF_RESOLUTION],
+            bands[CONF_WEIGHTING],
+            bands[CONF_MIN_FREQUENCY],
+            bands[CONF_MAX_FREQUENCY],
+            bands[CONF_UPDATE_INTERVAL],
+        ))
     await cg.register_component(var, config)
 
     # await microphone.register_microphone(var, config)
+
+
+@automation.register_action(
+    "detect_audio.set_sound_source",
+    SetSoundSourceAction,
+    cv.Schema({
+        cv.GenerateID(): cv.use_id(DetectAudioComponent),
+        cv.Required(CONF_NAME): cv.templatable(cv.string),
+        cv.Required(CONF_LEVEL): cv.templatable(cv.uint16_t),
+    }),
+)
+async def set_sound_source_to_code(config, action_id, template_arg, args):
+    parent = await cg.get_variable(config[CONF_ID])
+    var = cg.new_Pvariable(action_id, template_arg, parent)
+    name = await cg.templatable(config[CONF_NAME], args, cg.std_string)
+    cg.add(var.set_name(name))
+    level = await cg.templatable(config[CONF_LEVEL], args, cg.uint16)
+    cg.add(var.set_level(level))
+    return var
+
+
+@automation.register_action(
+    "detect_audio.remove_sound_source",
+    RemoveSoundSourceAction,
+    cv.Schema({
+        cv.GenerateID(): cv.use_id(DetectAudioComponent),
+        cv.Required(CONF_NAME): cv.templatable(cv.string),
+    }),
+)
+async def remove_sound_source_to_code(config, action_id, template_arg, args):
+    parent = await cg.get_variable(config[CONF_ID])
+    var = cg.new_Pvariable(action_id, template_arg, parent)
+    name = await cg.templatable(config[CONF_NAME], args, cg.std_string)
+    cg.add(var.set_name(name))
+    return var
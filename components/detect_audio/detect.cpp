@@ -22,7 +22,6 @@
 #include <Arduino.h>
 #include <driver/i2s.h>
 
-#define OCTAVES 9
 // A-weighting curve from 31.5 Hz ... 8000 Hz
 static const float aweighting[] = {-39.4, -26.2, -16.1, -8.6, -3.2,
                                    0.0,   1.2,   1.0,   -1.1};
@@ -33,8 +32,13 @@ namespace esphome {
 namespace detect_audio {
 
 DetectAudio::DetectAudio()
-    : m_mic(nullptr), m_currentPeak(), m_currentLoudness(), m_cnt(0), m_mn(),
-      m_mx(), m_sum(), m_clearMetrics() {
+    : m_mic(nullptr), m_averaging_mode(AVERAGING_NONE),
+      m_averaging_factor(0.25), m_welch_segments(8), m_avg_frames(0),
+      m_sampleRate(16000), m_bandFraction(0), m_bandWeighting(WEIGHTING_A),
+      m_bandMinFrequency(50), m_bandMaxFrequency(10000), m_bandInterval(10000),
+      m_bandCount(0), m_bandsTruncated(false), m_bands(nullptr),
+      m_bandFrames(0), m_currentPeak(), m_currentLoudness(),
+      m_cnt(0), m_mn(), m_mx(), m_sum(), m_clearMetrics() {
   m_currentPeak.set_accuracy_decimals(0);
   m_currentPeak.set_state_class(sensor::STATE_CLASS_MEASUREMENT);
   m_currentPeak.set_name("Current peak");
@@ -74,9 +78,33 @@ DetectAudio::DetectAudio()
   m_clearMetrics.set_name("Clear metrics");
   m_clearMetrics.set_object_id("detec_audio_clear_metrics_id");
   App.register_button(&m_clearMetrics);
+
+  // whole pool is registered up front, free slots stay internal
+  for (uint8_t i = 0; i < m_max_sound_sources; i++) {
+    m_sourceNames[i][0] = '\0';
+    m_sourceObjectIds[i][0] = '\0';
+    m_sourceLevels[i] = 0;
+    m_sourceActive[i] = false;
+    m_sourceMem[i] = 0;
+    m_sourceGenerations[i] = 0;
+    m_sourceSeenGeneration[i] = 0;
+    m_sourceSensors[i].set_device_class("sound");
+    m_sourceSensors[i].set_internal(true);
+    App.register_binary_sensor(&m_sourceSensors[i]);
+  }
+  m_tables[0].count = 0;
+  m_tables[1].count = 0;
+  m_activeTable.store(&m_tables[0]);
+  m_readerTable.store(nullptr);
+  m_sourcesDirty = false;
+  m_removedSlots = 0;
+  m_yamlSourcesHash = 0;
 }
 
-DetectAudio::~DetectAudio() { delete m_mic; }
+DetectAudio::~DetectAudio() {
+  delete m_mic;
+  delete[] m_bands;
+}
 
 void DetectAudio::setup() {
   ESP_LOGCONFIG(TAG, "Setting up audio detection...");
@@ -95,6 +123,57 @@ void DetectAudio::setup() {
     clearMetrics();
     m_currentPeak.publish_state(0);
 
+    for (uint8_t i = 0; i < m_octaves; i++) {
+      m_octaveGains[i] = pow(10, aweighting[i] / 10.0);
+    }
+    if (m_bandCount > 0) {
+      ESP_LOGCONFIG(TAG, "Bands 1/%d octave, %.1f Hz per bin", m_bandFraction,
+                    (float)m_sampleRate / m_buffer_size);
+      for (uint8_t b = 0; b < m_bandCount; b++) {
+        const band_t &band = m_bands[b];
+        ESP_LOGCONFIG(TAG, "  %s: bins %d-%d (%.2f/%.2f) gain %.4f", band.name,
+                      band.firstBin, band.lastBin, band.firstWeight,
+                      band.lastWeight, band.gain);
+      }
+      if (m_bandsTruncated) {
+        ESP_LOGW(TAG, "Too many bands, keeping first %d", m_max_bands);
+      }
+      set_interval("bands", m_bandInterval, [this]() { publishBands(); });
+    } else if (m_bandFraction != 0) {
+      ESP_LOGW(TAG, "No band fits into %.1f - %.1f Hz", m_bandMinFrequency,
+               m_bandMaxFrequency);
+    }
+
+    // stored sources are valid only for the yaml they were edited on top of
+    m_sourcesPref = global_preferences->make_preference<storedSoundSources_t>(
+        fnv1_hash("detect_audio_sources") ^ m_yamlSourcesHash);
+    storedSoundSources_t stored;
+    if (m_sourcesPref.load(&stored)) {
+      ESP_LOGCONFIG(TAG, "Restoring sound sources from flash");
+      for (uint8_t i = 0; i < m_max_sound_sources; i++) {
+        stored.sources[i].name[m_name_len - 1] = '\0';
+        if (stored.sources[i].name[0] != '\0') {
+          assignSoundSource(i, stored.sources[i].name,
+                            stored.sources[i].level);
+        } else {
+          m_sourceActive[i] = false;
+        }
+      }
+    }
+    for (uint8_t i = 0; i < m_max_sound_sources; i++) {
+      m_sourceSensors[i].set_internal(!m_sourceActive[i]);
+      m_sourceSensors[i].publish_state(false);
+    }
+    publishSoundSources();
+    m_sourcesDirty = false;
+
+#ifdef USE_API
+    register_service(&DetectAudio::setSoundSourceService, "set_sound_source",
+                     {"name", "level"});
+    register_service(&DetectAudio::removeSoundSourceService,
+                     "remove_sound_source", {"name"});
+#endif
+
     // m_mic->stop();
     // m_mic->set_sample_rate(22627);
     // m_mic->set_use_apll(true);
@@ -104,7 +183,14 @@ void DetectAudio::setup() {
 }
 
 void DetectAudio::loop() {
-  // this component works using its cb function
+  // this component works using its cb function, loop only hands over edited
+  // sound sources to it
+  if (m_sourcesDirty && publishSoundSources()) {
+    m_sourcesDirty = false;
+  }
+  if (m_removedSlots != 0 && !m_sourcesDirty) {
+    retireSoundSources();
+  }
 }
 
 void DetectAudio::set_i2s(i2s_audio::I2SAudioMicrophone *mic) {
@@ -113,29 +199,341 @@ void DetectAudio::set_i2s(i2s_audio::I2SAudioMicrophone *mic) {
 }
 
 void DetectAudio::addSoundSource(std::string soundSourceName, uint16_t peak) {
-  binary_sensor::BinarySensor *newSensor = new binary_sensor::BinarySensor();
-  char *name = new char[soundSourceName.length() + 1];
-  static char detectAudioStr[] = "detect_audio_";
-  static char detectAudioIdStr[] = "_id";
-  char *objectIdName =
-      new char[soundSourceName.length() + 1 + strlen(detectAudioStr) +
-               strlen(detectAudioIdStr)];
-  memcpy(name, soundSourceName.c_str(), soundSourceName.length());
-  name[soundSourceName.length()] = '\0';
-  newSensor->set_name(name);
-  memcpy(objectIdName, detectAudioStr, strlen(detectAudioStr));
-  memcpy(&objectIdName[strlen(detectAudioStr)], name, soundSourceName.length());
-  memcpy(&objectIdName[strlen(detectAudioStr) + soundSourceName.length()],
-         detectAudioIdStr, strlen(detectAudioIdStr));
-  objectIdName[soundSourceName.length() + strlen(detectAudioStr) +
-               strlen(detectAudioIdStr)] = '\0';
-  newSensor->set_object_id(objectIdName);
-  newSensor->set_device_class("sound");
-  App.register_binary_sensor(newSensor);
-  newSensor->publish_state(false);
-  m_soundSourcesIds.push_back({newSensor, peak, 0});
-  // free(name);
-  // free(objectIdName);
+  int slot = findSoundSource(soundSourceName);
+  if (slot < 0) {
+    slot = findFreeSoundSource();
+  }
+  if (slot < 0) {
+    ESP_LOGE(TAG, "No free slot for sound source %s",
+             soundSourceName.c_str());
+    return;
+  }
+  assignSoundSource(slot, soundSourceName, peak);
+  m_yamlSourcesHash = m_yamlSourcesHash * 31 + fnv1_hash(soundSourceName) + peak;
+}
+
+bool DetectAudio::setSoundSource(std::string soundSourceName, uint16_t peak) {
+  if (soundSourceName.empty()) {
+    ESP_LOGW(TAG, "Sound source name must not be empty");
+    return false;
+  }
+  int slot = findSoundSource(soundSourceName);
+  if (slot < 0) {
+    slot = findFreeSoundSource();
+    if (slot < 0) {
+      ESP_LOGW(TAG, "No free slot for sound source %s (max %d)",
+               soundSourceName.c_str(), m_max_sound_sources);
+      return false;
+    }
+    // new entity shows up in Home Assistant after next API reconnect
+    m_removedSlots &= ~(1u << slot);
+    m_sourceSensors[slot].set_internal(false);
+  }
+  ESP_LOGI(TAG, "Setting sound source %s to level %d",
+           soundSourceName.c_str(), peak);
+  assignSoundSource(slot, soundSourceName, peak);
+  saveSoundSources();
+  return true;
+}
+
+bool DetectAudio::removeSoundSource(std::string soundSourceName) {
+  int slot = soundSourceName.empty() ? -1 : findSoundSource(soundSourceName);
+  if (slot < 0) {
+    ESP_LOGW(TAG, "Unknown sound source %s", soundSourceName.c_str());
+    return false;
+  }
+  ESP_LOGI(TAG, "Removing sound source %s", soundSourceName.c_str());
+  // only drop the slot from the table, sensor keeps its name and is reset
+  // once analysis can no longer see the slot
+  m_sourceActive[slot] = false;
+  m_sourceLevels[slot] = 0;
+  m_sourceGenerations[slot]++;
+  m_sourcesDirty = true;
+  m_removedSlots |= 1u << slot;
+  saveSoundSources();
+  return true;
+}
+
+// returns pool slot holding given name
+int DetectAudio::findSoundSource(const std::string &soundSourceName) {
+  std::string name = soundSourceName.substr(0, m_name_len - 1);
+  for (uint8_t i = 0; i < m_max_sound_sources; i++) {
+    if (m_sourceActive[i] && name == m_sourceNames[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int DetectAudio::findFreeSoundSource() {
+  for (uint8_t i = 0; i < m_max_sound_sources; i++) {
+    if (!m_sourceActive[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void DetectAudio::assignSoundSource(uint8_t slot,
+                                    const std::string &soundSourceName,
+                                    uint16_t peak) {
+  static const char detectAudioStr[] = "detect_audio_";
+  static const char detectAudioIdStr[] = "_id";
+  if (soundSourceName.length() >= m_name_len) {
+    ESP_LOGW(TAG, "Sound source name %s truncated to %d chars",
+             soundSourceName.c_str(), m_name_len - 1);
+  }
+  // name and object id live in the pool, sensor keeps pointing to them
+  snprintf(m_sourceNames[slot], m_name_len, "%s", soundSourceName.c_str());
+  snprintf(m_sourceObjectIds[slot], sizeof(m_sourceObjectIds[slot]), "%s%s%s",
+           detectAudioStr, m_sourceNames[slot], detectAudioIdStr);
+  m_sourceSensors[slot].set_name(m_sourceNames[slot]);
+  m_sourceSensors[slot].set_object_id(m_sourceObjectIds[slot]);
+  m_sourceLevels[slot] = peak;
+  m_sourceActive[slot] = true;
+  m_sourceGenerations[slot]++;
+  m_sourcesDirty = true;
+}
+
+void DetectAudio::saveSoundSources() {
+  storedSoundSources_t stored;
+  memset(&stored, 0, sizeof(stored));
+  for (uint8_t i = 0; i < m_max_sound_sources; i++) {
+    if (m_sourceActive[i]) {
+      memcpy(stored.sources[i].name, m_sourceNames[i], m_name_len);
+      stored.sources[i].level = m_sourceLevels[i];
+    }
+  }
+  if (!m_sourcesPref.save(&stored)) {
+    ESP_LOGW(TAG, "Saving sound sources failed");
+  }
+}
+
+// copies the pool into the table nobody reads and swaps it in. Returns false
+// when the analysis path still walks that table, loop() retries later.
+bool DetectAudio::publishSoundSources() {
+  soundSourceTable_t *active = m_activeTable.load();
+  soundSourceTable_t *standby =
+      (active == &m_tables[0]) ? &m_tables[1] : &m_tables[0];
+  if (m_readerTable.load() == standby) {
+    return false;
+  }
+  standby->count = 0;
+  for (uint8_t i = 0; i < m_max_sound_sources; i++) {
+    if (m_sourceActive[i]) {
+      standby->sources[standby->count++] = {i, m_sourceGenerations[i],
+                                            m_sourceLevels[i]};
+    }
+  }
+  m_activeTable.store(standby);
+  return true;
+}
+
+// resets sensors of removed slots once the analysis path left the retired
+// table. New readers only pin the active table, so this cannot flip back.
+void DetectAudio::retireSoundSources() {
+  soundSourceTable_t *active = m_activeTable.load();
+  soundSourceTable_t *retired =
+      (active == &m_tables[0]) ? &m_tables[1] : &m_tables[0];
+  if (m_readerTable.load() == retired) {
+    return;
+  }
+  for (uint8_t i = 0; i < m_max_sound_sources; i++) {
+    if (m_removedSlots & (1u << i)) {
+      m_sourceSensors[i].publish_state(false);
+      m_sourceSensors[i].set_internal(true);
+    }
+  }
+  m_removedSlots = 0;
+}
+
+#ifdef USE_API
+void DetectAudio::setSoundSourceService(std::string name, int level) {
+  if (level < 0 || level > UINT16_MAX) {
+    ESP_LOGW(TAG, "Level %d out of range", level);
+    return;
+  }
+  setSoundSource(name, level);
+}
+
+void DetectAudio::removeSoundSourceService(std::string name) {
+  removeSoundSource(name);
+}
+#endif
+
+void DetectAudio::set_averaging_mode(AveragingMode mode) {
+  m_averaging_mode = mode;
+  m_avg_frames = 0;
+}
+
+void DetectAudio::set_averaging_factor(float factor) {
+  m_averaging_factor = factor;
+}
+
+void DetectAudio::set_welch_segments(uint8_t segments) {
+  m_welch_segments = segments > 0 ? segments : 1;
+}
+
+void DetectAudio::set_sample_rate(uint32_t sampleRate) {
+  m_sampleRate = sampleRate;
+}
+
+// called from codegen after set_sample_rate(), band sensors are registered
+// here like all other entities of this component, before setup()
+void DetectAudio::set_bands(uint8_t fraction, Weighting weighting,
+                            float minFrequency, float maxFrequency,
+                            uint32_t updateInterval) {
+  m_bandFraction = fraction;
+  m_bandWeighting = weighting;
+  m_bandMinFrequency = minFrequency;
+  m_bandMaxFrequency = maxFrequency;
+  m_bandInterval = updateInterval;
+  setupBands();
+}
+
+// edges of band k (center 1000 * 2^(k/b)) in bin coordinates, where bin i
+// covers (i .. i + 1), i.e. (i - 0.5 .. i + 0.5) * df. Returns false once the
+// band reaches past the last bin.
+bool DetectAudio::bandEdges(int k, float df, float *center, float *lo,
+                            float *hi) {
+  const float b = m_bandFraction;
+  *center = 1000.0 * pow(2, k / b);
+  *lo = *center * pow(2, -0.5 / b) / df + 0.5;
+  *hi = *center * pow(2, 0.5 / b) / df + 0.5;
+  if (*lo < 1) {
+    // skip DC bin
+    *lo = 1;
+  }
+  return *hi <= m_buffer_size / 2 + 1;
+}
+
+// maps base-2 fractional-octave bands to FFT bins, edge bins count by their
+// overlap. All transcendental math happens here, once.
+void DetectAudio::setupBands() {
+  delete[] m_bands;
+  m_bands = nullptr;
+  m_bandCount = 0;
+  m_bandsTruncated = false;
+  if (m_bandFraction == 0 || m_sampleRate == 0 || !(m_bandMinFrequency > 0) ||
+      !(m_bandMinFrequency < m_bandMaxFrequency)) {
+    return;
+  }
+  const float df = (float)m_sampleRate / m_buffer_size;
+  const float nyquist = m_sampleRate / 2.0;
+  const float maxFrequency =
+      m_bandMaxFrequency < nyquist ? m_bandMaxFrequency : nyquist;
+  if (!(m_bandMinFrequency < maxFrequency)) {
+    return;
+  }
+  const int kMin = (int)ceil(m_bandFraction * log2(m_bandMinFrequency / 1000.0));
+  const int kMax = (int)floor(m_bandFraction * log2(maxFrequency / 1000.0));
+  float center, lo, hi;
+
+  // first pass only counts, so the pool is sized to what is configured
+  uint8_t count = 0;
+  for (int k = kMin; k <= kMax; k++) {
+    if (!bandEdges(k, df, &center, &lo, &hi)) {
+      break;
+    }
+    if (hi > lo) {
+      if (count == m_max_bands) {
+        m_bandsTruncated = true;
+        break;
+      }
+      count++;
+    }
+  }
+  if (count == 0) {
+    return;
+  }
+  m_bands = new band_t[count];
+
+  for (int k = kMin; k <= kMax && m_bandCount < count; k++) {
+    bandEdges(k, df, &center, &lo, &hi);
+    if (hi <= lo) {
+      continue;
+    }
+    band_t &band = m_bands[m_bandCount];
+    band.firstBin = (uint16_t)lo;
+    band.lastBin = (uint16_t)ceil(hi) - 1;
+    if (band.firstBin == band.lastBin) {
+      band.firstWeight = hi - lo;
+      band.lastWeight = 0;
+    } else {
+      band.firstWeight = band.firstBin + 1 - lo;
+      band.lastWeight = hi - band.lastBin;
+    }
+    band.gain = weightingGain(center);
+    band.energy = 0;
+
+    if (center < 100) {
+      snprintf(band.name, sizeof(band.name), "Band %.1f Hz", center);
+    } else {
+      snprintf(band.name, sizeof(band.name), "Band %.0f Hz", center);
+    }
+    snprintf(band.objectId, sizeof(band.objectId), "detect_audio_band_%d_id",
+             (int)lroundf(center * 10));
+    band.sensor.set_accuracy_decimals(1);
+    band.sensor.set_state_class(sensor::STATE_CLASS_MEASUREMENT);
+    band.sensor.set_name(band.name);
+    band.sensor.set_object_id(band.objectId);
+    band.sensor.set_device_class("sound_pressure");
+    band.sensor.set_unit_of_measurement("dB");
+    App.register_sensor(&band.sensor);
+    m_bandCount++;
+  }
+}
+
+// IEC 61672 A/C weighting as linear power gain
+float DetectAudio::weightingGain(float frequency) {
+  const float f2 = sq(frequency);
+  const float c1 = sq(20.6), c2 = sq(107.7), c3 = sq(737.9), c4 = sq(12194.0);
+  float r;
+  switch (m_bandWeighting) {
+  case WEIGHTING_A:
+    r = c4 * sq(f2) /
+        ((f2 + c1) * sqrt((f2 + c2) * (f2 + c3)) * (f2 + c4));
+    return sq(r) * pow(10, 2.0 / 10.0);
+  case WEIGHTING_C:
+    r = c4 * f2 / ((f2 + c1) * (f2 + c4));
+    return sq(r) * pow(10, 0.06 / 10.0);
+  default:
+    return 1.0;
+  }
+}
+
+// adds weighted energy of current spectrum to every band, one walk over bins.
+// Mic data callback runs from I2SAudioMicrophone::loop(), the same thread as
+// the publishing interval, so accumulators need no handoff.
+void DetectAudio::accumulateBands() {
+  for (uint8_t b = 0; b < m_bandCount; b++) {
+    band_t &band = m_bands[b];
+    float sum = band.firstWeight * m_real[band.firstBin];
+    if (band.lastBin > band.firstBin) {
+      for (uint16_t i = band.firstBin + 1; i < band.lastBin; i++) {
+        sum += m_real[i];
+      }
+      sum += band.lastWeight * m_real[band.lastBin];
+    }
+    band.energy += band.gain * sum;
+  }
+  m_bandFrames++;
+}
+
+// publishes mean band levels of the interval which just ended
+void DetectAudio::publishBands() {
+  // floor keeps silence (zero energy) finite instead of -inf dB
+  static const float minEnergy = 1e-10;
+  if (m_bandFrames == 0) {
+    return;
+  }
+  for (uint8_t b = 0; b < m_bandCount; b++) {
+    band_t &band = m_bands[b];
+    float energy = band.energy / m_bandFrames;
+    band.sensor.publish_state(decibel(energy > minEnergy ? energy : minEnergy));
+    band.energy = 0;
+  }
+  m_bandFrames = 0;
 }
 
 void DetectAudio::clearMetrics() {
@@ -153,6 +551,33 @@ void DetectAudio::calculateEnergy() {
     m_imag[i] = 0.0;
   }
 }
+// folds the current power spectrum into the running average and writes the
+// average back into the Re part, so peak search and band energies read it
+void DetectAudio::averageSpectrum() {
+  uint16_t bins = (m_buffer_len >> 1) + 2;
+  if (bins > m_buffer_len) {
+    bins = m_buffer_len;
+  }
+  if (m_avg_frames == 0) {
+    memcpy(m_avg_power, m_real, bins * sizeof(float));
+    m_avg_frames = 1;
+    return;
+  }
+  float alpha = m_averaging_factor;
+  if (m_averaging_mode == AVERAGING_WELCH) {
+    // plain mean of the first K segments, then exponential smoothing with
+    // factor 1/K, so older segments fade out rather than drop out
+    if (m_avg_frames < m_welch_segments) {
+      m_avg_frames++;
+    }
+    alpha = 1.0 / m_avg_frames;
+  }
+  for (uint16_t i = 0; i < bins; i++) {
+    m_avg_power[i] += alpha * (m_real[i] - m_avg_power[i]);
+    m_real[i] = m_avg_power[i];
+  }
+}
+
 // sums up energy in bins per octave
 void DetectAudio::sumEnergy(float *energies, int bin_size, int num_octaves) {
   // skip the first bin
@@ -167,15 +592,13 @@ void DetectAudio::sumEnergy(float *energies, int bin_size, int num_octaves) {
   }
 }
 
-float DetectAudio::decibel(float v) { return 10.0 * log(v) / log(10); }
-// converts energy to logaritmic, returns A-weighted sum
-float DetectAudio::calculateLoudness(float *energies, const float *weights,
+float DetectAudio::decibel(float v) { return 10.0 * log10f(v); }
+// returns weighted sum of octave energies in dB, gains are linear
+float DetectAudio::calculateLoudness(const float *energies, const float *gains,
                                      int num_octaves, float scale) {
   float sum = 0.0;
   for (int i = 0; i < num_octaves; i++) {
-    float energy = scale * energies[i];
-    sum += energy * pow(10, weights[i] / 10.0);
-    energies[i] = decibel(energy);
+    sum += scale * energies[i] * gains[i];
   }
   // ESP_LOGI(TAG, "decibel %f", sum);
   return decibel(sum);
@@ -233,6 +656,15 @@ void DetectAudio::micDataCb(const std::vector<int16_t> &data) {
     return;
   }
 
+  // Welch: keep the newest half of the segment, next FFT overlaps it by 50%.
+  // Halved hop means this runs twice as often, so the detection history and
+  // sum loudness cover half the wall-clock time of other modes.
+  uint16_t overlap = 0;
+  if (m_averaging_mode == AVERAGING_WELCH) {
+    overlap = m_buffer_len >> 1;
+    memcpy(m_overlap, &m_real[m_buffer_len - overlap], overlap * sizeof(float));
+  }
+
   arduinoFFT fft(m_real, m_imag, m_buffer_len, m_buffer_len);
 
   // apply flat top window, optimal for energy calculations
@@ -241,32 +673,52 @@ void DetectAudio::micDataCb(const std::vector<int16_t> &data) {
 
   // calculate energy in each bin
   calculateEnergy();
-  float energy[OCTAVES];
+  if (m_averaging_mode != AVERAGING_NONE) {
+    averageSpectrum();
+  }
+  float energy[m_octaves];
   // sum up energy in bin for each octave
-  sumEnergy(energy, 1, OCTAVES);
-  // calculate loudness per octave + A weighted loudness
+  sumEnergy(energy, 1, m_octaves);
+  // calculate A weighted loudness
   m_currentLoudness.publish_state(
-      calculateLoudness(energy, aweighting, OCTAVES, 1.0));
+      calculateLoudness(energy, m_octaveGains, m_octaves, 1.0));
+  accumulateBands();
   unsigned int peak = (int)floor(fft.MajorPeak());
   // Serial.println(peak);
 
   ESP_LOGI(TAG, "%s %s peak %d", __DATE__, __TIME__, peak);
   m_currentPeak.publish_state(peak);
 
-  for (auto &soundSource : m_soundSourcesIds) {
-    ESP_LOGI(TAG, "detecting %d %d", soundSource.mem, soundSource.level);
-    if (detectFrequency(&soundSource.mem, 15, peak, soundSource.level,
+  // pin the current table, recheck guards against a swap in between
+  soundSourceTable_t *table;
+  do {
+    table = m_activeTable.load();
+    m_readerTable.store(table);
+  } while (table != m_activeTable.load());
+
+  for (uint8_t i = 0; i < table->count; i++) {
+    const soundSource_t &soundSource = table->sources[i];
+    unsigned int *mem = &m_sourceMem[soundSource.slot];
+    if (m_sourceSeenGeneration[soundSource.slot] != soundSource.generation) {
+      // slot was reassigned or retuned, forget old history
+      *mem = 0;
+      m_sourceSeenGeneration[soundSource.slot] = soundSource.generation;
+    }
+    ESP_LOGI(TAG, "detecting %d %d", *mem, soundSource.level);
+    if (detectFrequency(mem, 15, peak, soundSource.level,
                         soundSource.level + 1, true)) {
-      soundSource.soundSensor->publish_state(true);
+      m_sourceSensors[soundSource.slot].publish_state(true);
       ESP_LOGI(TAG, "source detected");
     } else {
-      soundSource.soundSensor->publish_state(false);
+      m_sourceSensors[soundSource.slot].publish_state(false);
       ESP_LOGI(TAG, "source not detected");
     }
   }
+  m_readerTable.store(nullptr);
 
   calculateMetrics(m_currentLoudness.get_state());
-  m_buffer_len = 0;
+  memcpy(m_real, m_overlap, overlap * sizeof(float));
+  m_buffer_len = overlap;
 }
 
 } // namespace detect_audio
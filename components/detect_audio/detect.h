@@ -24,6 +24,13 @@
 #include "esphome/components/button/button.h"
 #include "esphome/components/i2s_audio/microphone/i2s_audio_microphone.h"
 #include "esphome/components/sensor/sensor.h"
+#include "esphome/core/automation.h"
+#include "esphome/core/preferences.h"
+#ifdef USE_API
+#include "esphome/components/api/custom_api_device.h"
+#endif
+
+#include <atomic>
 
 namespace esphome {
 
@@ -33,12 +40,62 @@ class DetectAudioButton : public button::Button {
   void press_action() override {}
 };
 
-class DetectAudio : public Component {
+class DetectAudio : public Component
+#ifdef USE_API
+                    , public api::CustomAPIDevice
+#endif
+{
 public:
+  static constexpr uint8_t m_max_sound_sources = 8;
+  static constexpr uint8_t m_name_len = 32; // including '\0'
+  static constexpr uint8_t m_max_bands = 48;
+  static constexpr uint8_t m_octaves = 9;
+
+  enum AveragingMode : uint8_t {
+    AVERAGING_NONE = 0,
+    AVERAGING_EXPONENTIAL,
+    AVERAGING_WELCH,
+  };
+
+  enum Weighting : uint8_t {
+    WEIGHTING_A = 0,
+    WEIGHTING_C,
+    WEIGHTING_Z,
+  };
+
+  // fractional-octave band mapped to FFT bins, edge bins counted partially
+  struct band_t {
+    uint16_t firstBin;
+    uint16_t lastBin;
+    float firstWeight;
+    float lastWeight;
+    float gain;   // linear power weighting gain at band center
+    float energy; // weighted energy summed since last publish
+    sensor::Sensor sensor;
+    char name[m_name_len];
+    char objectId[m_name_len + 16];
+  };
+
+  // one entry of the table read by the analysis path, slot indexes the pool
   struct soundSource_t {
-    binary_sensor::BinarySensor *soundSensor;
+    uint8_t slot;
+    uint8_t generation; // bumped on every (re)assignment of the slot
+    uint16_t level;
+  };
+
+  struct soundSourceTable_t {
+    uint8_t count;
+    soundSource_t sources[m_max_sound_sources];
+  };
+
+  // flash layout, empty name marks free slot
+  struct storedSoundSource_t {
+    char name[m_name_len];
     uint16_t level;
-    unsigned int mem;
+  };
+
+  struct storedSoundSources_t {
+    storedSoundSource_t sources[m_max_sound_sources];
   };
 
   DetectAudio();
@@ -54,6 +111,23 @@ public:
 
   void addSoundSource(std::string soundSourceName, uint16_t peak);
 
+  // runtime add or update, keyed by name, persisted to flash
+  bool setSoundSource(std::string soundSourceName, uint16_t peak);
+
+  bool removeSoundSource(std::string soundSourceName);
+
+  void set_averaging_mode(AveragingMode mode);
+
+  void set_averaging_factor(float factor);
+
+  void set_welch_segments(uint8_t segments);
+
+  void set_sample_rate(uint32_t sampleRate);
+
+  // fraction 1 = full octave, 3 = 1/3 octave, 6 = 1/6 octave
+  void set_bands(uint8_t fraction, Weighting weighting, float minFrequency,
+                 float maxFrequency, uint32_t updateInterval);
+
   void clearMetrics();
 
 protected:
@@ -64,8 +138,48 @@ private:
   float m_real[m_buffer_size];
   float m_imag[m_buffer_size];
   uint16_t m_buffer_len;
+  // averaged power spectrum, bins 0 .. N/2 (+1 guard bin for peak search)
+  float m_avg_power[m_buffer_size / 2 + 2];
+  // second half of the previous segment, reused in Welch mode (50% overlap)
+  float m_overlap[m_buffer_size / 2];
+  AveragingMode m_averaging_mode;
+  float m_averaging_factor;
+  uint8_t m_welch_segments;
+  uint8_t m_avg_frames;
+  uint32_t m_sampleRate;
+  // legacy octave loudness, A-weighting as linear gains
+  float m_octaveGains[m_octaves];
+  // fractional-octave analyzer, m_bandFraction 0 = disabled
+  uint8_t m_bandFraction;
+  Weighting m_bandWeighting;
+  float m_bandMinFrequency;
+  float m_bandMaxFrequency;
+  uint32_t m_bandInterval;
+  uint8_t m_bandCount;
+  bool m_bandsTruncated;
+  band_t *m_bands; // allocated by set_bands() only
+  unsigned int m_bandFrames;
   unsigned int m_cnt;
-  std::vector<soundSource_t> m_soundSourcesIds;
+  // fixed pool of sensors and their name/object id storage
+  binary_sensor::BinarySensor m_sourceSensors[m_max_sound_sources];
+  char m_sourceNames[m_max_sound_sources][m_name_len];
+  char m_sourceObjectIds[m_max_sound_sources][m_name_len + 16];
+  uint16_t m_sourceLevels[m_max_sound_sources];
+  bool m_sourceActive[m_max_sound_sources];
+  uint8_t m_sourceGenerations[m_max_sound_sources];
+  // slots removed but maybe still read through the retired table
+  uint32_t m_removedSlots;
+  // owned by analysis path
+  unsigned int m_sourceMem[m_max_sound_sources];
+  uint8_t m_sourceSeenGeneration[m_max_sound_sources];
+  // read-copy-update: analysis reads m_activeTable, loop() publishes edits
+  // into the table nobody reads and swaps the pointer
+  soundSourceTable_t m_tables[2];
+  std::atomic<soundSourceTable_t *> m_activeTable;
+  std::atomic<soundSourceTable_t *> m_readerTable;
+  bool m_sourcesDirty;
+  uint32_t m_yamlSourcesHash;
+  ESPPreferenceObject m_sourcesPref;
   sensor::Sensor m_currentPeak;
   sensor::Sensor m_currentLoudness;
   sensor::Sensor m_sum;
@@ -75,11 +189,42 @@ private:
 
   void calculateEnergy();
 
+  void averageSpectrum();
+
+  int findSoundSource(const std::string &soundSourceName);
+
+  int findFreeSoundSource();
+
+  void assignSoundSource(uint8_t slot, const std::string &soundSourceName,
+                         uint16_t peak);
+
+  void saveSoundSources();
+
+  bool publishSoundSources();
+
+  void retireSoundSources();
+
+#ifdef USE_API
+  void setSoundSourceService(std::string name, int level);
+
+  void removeSoundSourceService(std::string name);
+#endif
+
+  bool bandEdges(int k, float df, float *center, float *lo, float *hi);
+
+  void setupBands();
+
+  float weightingGain(float frequency);
+
+  void accumulateBands();
+
+  void publishBands();
+
   void sumEnergy(float *energies, int bin_size, int num_octaves);
 
   float decibel(float v);
 
-  float calculateLoudness(float *energies, const float *weights,
+  float calculateLoudness(const float *energies, const float *gains,
                           int num_octaves, float scale);
 
   unsigned int countSetBits(unsigned int n);
@@ -91,6 +236,37 @@ private:
   void calculateMetrics(int val);
 };
 
+template <typename... Ts>
+class SetSoundSourceAction : public Action<Ts...> {
+public:
+  explicit SetSoundSourceAction(DetectAudio *parent) : m_parent(parent) {}
+
+  TEMPLATABLE_VALUE(std::string, name)
+  TEMPLATABLE_VALUE(uint16_t, level)
+
+  void play(Ts... x) override {
+    m_parent->setSoundSource(this->name_.value(x...), this->level_.value(x...));
+  }
+
+protected:
+  DetectAudio *m_parent;
+};
+
+template <typename... Ts>
+class RemoveSoundSourceAction : public Action<Ts...> {
+public:
+  explicit RemoveSoundSourceAction(DetectAudio *parent) : m_parent(parent) {}
+
+  TEMPLATABLE_VALUE(std::string, name)
+
+  void play(Ts... x) override {
+    m_parent->removeSoundSource(this->name_.value(x...));
+  }
+
+protected:
+  DetectAudio *m_parent;
+};
+
 } // namespace detect_audio
 } // namespace esphome
 